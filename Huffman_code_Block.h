@@ -0,0 +1,435 @@
+// Block mode ('B') decoder shared by Huffman_code_Decompress and the
+// -D service of Huffman_code_Compress. Include it after struct MinHNode,
+// isLeaf, buildHuffmanTree and freeHuffmanTree
+#ifndef HUFFMAN_CODE_BLOCK_H
+#define HUFFMAN_CODE_BLOCK_H
+
+// Code tables the block encoder and decoder keep warm
+#define TABLE_CACHE_SIZE 4
+// Set in the header's longest block field when adaptiveBlockEnds cut the blocks
+#define ADAPTIVE_BLOCKS 0x80000000u
+
+// Big endian 32-bit value from the header
+unsigned getU32(const unsigned char *p)
+{
+    return ((unsigned)p[0] << 24) | ((unsigned)p[1] << 16) | ((unsigned)p[2] << 8) | p[3];
+}
+
+unsigned long long getU64(const unsigned char *p)
+{
+    return ((unsigned long long)getU32(p) << 32) | getU32(p + 4);
+}
+
+// Reads codes MSB first, past the end it returns zero bits
+struct BitReader
+{
+    const unsigned char *buf;
+    size_t len;
+    size_t pos;
+    unsigned long long acc;
+    int nbits;
+};
+
+void initBitReader(struct BitReader *br, const unsigned char *buf, size_t len)
+{
+    br->buf = buf;
+    br->len = len;
+    br->pos = 0;
+    br->acc = 0;
+    br->nbits = 0;
+}
+
+void refillBits(struct BitReader *br)
+{
+    while (br->nbits <= 56)
+    {
+        br->acc = (br->acc << 8) | (br->pos < br->len ? br->buf[br->pos] : 0);
+        br->pos++;
+        br->nbits += 8;
+    }
+}
+
+// Look at the next n bits (n <= 32) without consuming them
+unsigned peekBits(struct BitReader *br, int n)
+{
+    if (br->nbits < n)
+        refillBits(br);
+    return (unsigned)(br->acc >> (br->nbits - n)) & (unsigned)((1ULL << n) - 1);
+}
+
+void skipBits(struct BitReader *br, int n)
+{
+    br->nbits -= n;
+}
+
+unsigned readBits(struct BitReader *br, int n)
+{
+    unsigned value = peekBits(br, n);
+
+    skipBits(br, n);
+    return value;
+}
+
+// Bits looked up at once by the decode table
+#define TABLE_BITS 12
+
+// Symbol and code length for every TABLE_BITS bit prefix.
+// Longer codes keep the subtree to continue from in next[]
+struct DecodeTable
+{
+    int sym[1 << TABLE_BITS];
+    unsigned char len[1 << TABLE_BITS];
+    struct MinHNode *next[1 << TABLE_BITS];
+    struct MinHNode *root;
+};
+
+void fillDecodeTable(struct DecodeTable *dt, struct MinHNode *root, unsigned code, int top)
+{
+    if (isLeaf(root))
+    {
+        // A lone symbol is coded with one bit
+        int len = top ? top : 1;
+        int shift = TABLE_BITS - len;
+
+        for (unsigned i = 0; i < (1u << shift); i++)
+        {
+            dt->sym[(code << shift) | i] = root->item;
+            dt->len[(code << shift) | i] = len;
+        }
+        return;
+    }
+
+    if (top == TABLE_BITS)
+    {
+        dt->next[code] = root;
+        return;
+    }
+
+    fillDecodeTable(dt, root->left, code << 1, top + 1);
+    fillDecodeTable(dt, root->right, (code << 1) | 1, top + 1);
+}
+
+struct DecodeTable *newDecodeTable(struct MinHNode *root)
+{
+    struct DecodeTable *dt = (struct DecodeTable *)calloc(1, sizeof(struct DecodeTable));
+
+    dt->root = root;
+    fillDecodeTable(dt, root, 0, 0);
+
+    return dt;
+}
+
+// Decode one symbol, -1 on a code that isn't in the table
+int decodeSymbol(struct DecodeTable *dt, struct BitReader *br)
+{
+    unsigned idx = peekBits(br, TABLE_BITS);
+
+    if (dt->len[idx])
+    {
+        skipBits(br, dt->len[idx]);
+        return dt->sym[idx];
+    }
+
+    struct MinHNode *current = dt->next[idx];
+
+    if (current == NULL)
+        return -1;
+
+    skipBits(br, TABLE_BITS);
+    while (!isLeaf(current))
+        current = readBits(br, 1) ? current->right : current->left;
+
+    return current->item;
+}
+
+// Decode tables of the last TABLE_CACHE_SIZE 'N' blocks,
+// replaced round robin like the encoder's cache. A slot keeps
+// its table memory between streams, root is NULL while it is empty
+struct BlockDecoder
+{
+    struct DecodeTable *cache[TABLE_CACHE_SIZE];
+    int cacheNext;
+};
+
+void initBlockDecoder(struct BlockDecoder *dec)
+{
+    for (int i = 0; i < TABLE_CACHE_SIZE; i++)
+        dec->cache[i] = NULL;
+    dec->cacheNext = 0;
+}
+
+// Empty the slots before the next stream but keep their tables
+void resetBlockDecoder(struct BlockDecoder *dec)
+{
+    for (int i = 0; i < TABLE_CACHE_SIZE; i++)
+    {
+        if (dec->cache[i] != NULL)
+        {
+            freeHuffmanTree(dec->cache[i]->root);
+            dec->cache[i]->root = NULL;
+        }
+    }
+    dec->cacheNext = 0;
+}
+
+void freeBlockDecoder(struct BlockDecoder *dec)
+{
+    resetBlockDecoder(dec);
+    for (int i = 0; i < TABLE_CACHE_SIZE; i++)
+        free(dec->cache[i]);
+}
+
+// Read the table of an 'N' record into the next cache slot,
+// returns the record bytes used or 0 if it is cut short
+size_t loadBlockTable(struct BlockDecoder *dec, const unsigned char *p, size_t avail)
+{
+    if (avail < 1)
+        return 0;
+
+    int size = p[0] + 1;
+    int item[256], freq[256];
+
+    if (avail < 1 + (size_t)size * 5)
+        return 0;
+
+    for (int i = 0; i < size; i++)
+    {
+        item[i] = p[1 + i * 5];
+        freq[i] = (int)getU32(p + 2 + i * 5);
+    }
+
+    struct DecodeTable *dt = dec->cache[dec->cacheNext];
+    struct MinHNode *root = buildHuffmanTree(item, freq, size);
+
+    if (dt == NULL)
+        dec->cache[dec->cacheNext] = newDecodeTable(root);
+    else
+    {
+        freeHuffmanTree(dt->root);
+        memset(dt, 0, sizeof(struct DecodeTable));
+        dt->root = root;
+        fillDecodeTable(dt, root, 0, 0);
+    }
+    dec->cacheNext = (dec->cacheNext + 1) % TABLE_CACHE_SIZE;
+
+    return 1 + size * 5;
+}
+
+// Unpack an 'F' record. Every packed byte expands through a table
+// to 8, 4 or 2 output bytes at once
+size_t decodeFixedBlock(const unsigned char *p, size_t avail, unsigned char *out, size_t outCap, size_t *rawLen)
+{
+    if (avail < 2)
+        return 0;
+
+    int count = p[1] + 1;
+    size_t pos = 2 + count;
+
+    if (count > 16 || pos + 8 > avail)
+        return 0;
+
+    const unsigned char *symbols = p + 2;
+    int width = count <= 2 ? 1 : count <= 4 ? 2 : 4;
+    int per = 8 / width;
+    size_t n = getU32(p + pos);
+    size_t payload = getU32(p + pos + 4);
+    pos += 8;
+
+    if (pos + payload > avail || n > outCap || payload < (n * width + 7) / 8)
+        return 0;
+
+    unsigned char expand[256][8];
+
+    for (int b = 0; b < 256; b++)
+    {
+        for (int i = 0; i < per; i++)
+        {
+            int idx = (b >> (8 - width * (i + 1))) & ((1 << width) - 1);
+
+            expand[b][i] = idx < count ? symbols[idx] : 0;
+        }
+    }
+
+    const unsigned char *packed = p + pos;
+    size_t full = n / per;
+
+    switch (width)
+    {
+    case 1:
+        for (size_t k = 0; k < full; k++)
+            memcpy(out + k * 8, expand[packed[k]], 8);
+        break;
+    case 2:
+        for (size_t k = 0; k < full; k++)
+            memcpy(out + k * 4, expand[packed[k]], 4);
+        break;
+    default:
+        for (size_t k = 0; k < full; k++)
+            memcpy(out + k * 2, expand[packed[k]], 2);
+    }
+
+    if (full * per < n)
+        memcpy(out + full * per, expand[packed[full]], n - full * per);
+
+    *rawLen = n;
+    return pos + payload;
+}
+
+// Decode one block record into out, returns the record
+// length or 0 on bad data. *rawLen gets the decoded size
+size_t decodeBlock(struct BlockDecoder *dec, const unsigned char *p, size_t avail,
+                   unsigned char *out, size_t outCap, size_t *rawLen)
+{
+    struct DecodeTable *dt;
+    size_t pos = 1;
+
+    if (avail < 2)
+        return 0;
+
+    if (p[0] == 'F')
+        return decodeFixedBlock(p, avail, out, outCap, rawLen);
+
+    if (p[0] == 'N')
+    {
+        size_t used = loadBlockTable(dec, p + 1, avail - 1);
+
+        if (used == 0)
+            return 0;
+        pos += used;
+        dt = dec->cache[(dec->cacheNext + TABLE_CACHE_SIZE - 1) % TABLE_CACHE_SIZE];
+    }
+    else if (p[0] == 'R' && p[1] < TABLE_CACHE_SIZE && dec->cache[p[1]] != NULL && dec->cache[p[1]]->root != NULL)
+    {
+        dt = dec->cache[p[1]];
+        pos++;
+    }
+    else
+        return 0;
+
+    if (pos + 8 > avail)
+        return 0;
+
+    size_t n = getU32(p + pos);
+    size_t payload = getU32(p + pos + 4);
+    pos += 8;
+
+    if (pos + payload > avail || n > outCap)
+        return 0;
+
+    struct BitReader br;
+    initBitReader(&br, p + pos, payload);
+
+    for (size_t i = 0; i < n; i++)
+    {
+        int sym = decodeSymbol(dt, &br);
+
+        if (sym < 0)
+            return 0;
+        out[i] = (unsigned char)sym;
+    }
+
+    *rawLen = n;
+    return pos + payload;
+}
+
+// Size of one index entry: kind, raw length, hash and value
+#define INDEX_ENTRY 21
+
+// Decode a whole block mode ('B') file. The index at the end lists
+// every block, stored blocks are decoded in order and repeated blocks
+// are copied from the output of the block they repeat. The output
+// goes to *out, grown as needed (on failure *out and *outCap are left
+// as they were). Returns 0, or 9 with a reason in error
+int decodeBlockStream(struct BlockDecoder *dec, const unsigned char *buf, size_t len, unsigned char **out,
+                      size_t *outCap, size_t *total, int *duplicates, char *error, size_t errorSize)
+{
+    if (len < 7 + 12)
+    {
+        snprintf(error, errorSize, "Header is cut short");
+        return 9;
+    }
+
+    size_t longest = getU32(buf + 3) & ~ADAPTIVE_BLOCKS;
+    size_t indexOffset = getU64(buf + len - 12);
+    size_t count = getU32(buf + len - 4);
+
+    if (indexOffset < 7 || indexOffset > len - 12 || (len - 12 - indexOffset) / INDEX_ENTRY != count)
+    {
+        snprintf(error, errorSize, "Block index is damaged");
+        return 9;
+    }
+
+    const unsigned char *index = buf + indexOffset;
+    size_t *start = (size_t *)malloc((count + 1) * sizeof(size_t));
+
+    if (start == NULL)
+    {
+        snprintf(error, errorSize, "Not enough memory for %zu blocks", count);
+        return 9;
+    }
+
+    // Check every length before any of them sizes the output: no block
+    // is longer than the header says, a repeat has the length of the
+    // earlier block it repeats and a record lies before the index
+    *total = 0;
+    *duplicates = 0;
+    for (size_t b = 0; b < count; b++)
+    {
+        const unsigned char *entry = index + b * INDEX_ENTRY;
+        size_t rawLen = getU32(entry + 1);
+        unsigned long long value = getU64(entry + 13);
+
+        if (rawLen > longest
+            || (entry[0] == 'D' ? value >= b || getU32(index + value * INDEX_ENTRY + 1) != rawLen
+                                : value < 7 || value >= indexOffset))
+        {
+            snprintf(error, errorSize, "Block index is damaged at block %zu", b);
+            free(start);
+            return 9;
+        }
+
+        start[b] = *total;
+        *total += rawLen;
+    }
+
+    if (*out == NULL || *outCap < *total + 1)
+    {
+        unsigned char *grown = (unsigned char *)realloc(*out, *total + 1);
+
+        if (grown == NULL)
+        {
+            snprintf(error, errorSize, "Not enough memory for %zu bytes", *total);
+            free(start);
+            return 9;
+        }
+        *out = grown;
+        *outCap = *total + 1;
+    }
+
+    int result = 0;
+
+    for (size_t b = 0; b < count && result == 0; b++)
+    {
+        const unsigned char *entry = index + b * INDEX_ENTRY;
+        size_t rawLen = getU32(entry + 1);
+        unsigned long long value = getU64(entry + 13);
+        size_t n = 0;
+
+        if (entry[0] == 'D')
+        {
+            memcpy(*out + start[b], *out + start[value], rawLen);
+            (*duplicates)++;
+        }
+        else if (decodeBlock(dec, buf + value, indexOffset - value, *out + start[b], rawLen, &n) == 0
+                 || n != rawLen)
+        {
+            snprintf(error, errorSize, "Corrupt block %zu", b);
+            result = 9;
+        }
+    }
+
+    free(start);
+    return result;
+}
+
+#endif
@@ -0,0 +1,89 @@
+// Client for the resident compressor (Huffman_code_Compress -D socket)
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#define MAX_REQUEST 8192
+
+// The server runs in its own directory, so send full paths
+void absolutePath(const char *path, char *full, size_t size)
+{
+    char cwd[4096];
+
+    if (path[0] == '/' || getcwd(cwd, sizeof(cwd)) == NULL)
+        snprintf(full, size, "%s", path);
+    else
+        snprintf(full, size, "%s/%s", cwd, path);
+}
+
+int main(int argc, char *argv[])
+{
+    char request[MAX_REQUEST];
+
+    // socket -b input output   compress
+    // socket -d input output   decompress
+    // socket -stats            latency percentiles
+    if (argc == 3 && strcmp(argv[2], "-stats") == 0)
+        snprintf(request, sizeof(request), "STATS\n");
+    else if (argc == 5 && (strcmp(argv[2], "-b") == 0 || strcmp(argv[2], "-d") == 0))
+    {
+        char inName[4000], outName[4000];
+
+        absolutePath(argv[3], inName, sizeof(inName));
+        absolutePath(argv[4], outName, sizeof(outName));
+        snprintf(request, sizeof(request), "%s\t%s\t%s\n", argv[2][1] == 'b' ? "C" : "D", inName, outName);
+    }
+    else
+    {
+        printf("Usage: %s socket -b|-d input output\n", argv[0]);
+        printf("       %s socket -stats\n", argv[0]);
+        return 2;
+    }
+
+    struct sockaddr_un addr;
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    snprintf(addr.sun_path, sizeof(addr.sun_path), "%s", argv[1]);
+
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    if (fd < 0 || connect(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0)
+    {
+        printf("Can't connect to %s\n", argv[1]);
+        return 1;
+    }
+
+    if (write(fd, request, strlen(request)) != (ssize_t)strlen(request))
+    {
+        printf("Can't send request\n");
+        close(fd);
+        return 1;
+    }
+
+    char reply[512];
+    size_t got = 0;
+    ssize_t n;
+
+    while (got < sizeof(reply) - 1 && (n = read(fd, reply + got, sizeof(reply) - 1 - got)) > 0)
+        got += n;
+    reply[got] = '\0';
+    close(fd);
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    long long micros = (end.tv_sec - start.tv_sec) * 1000000LL + (end.tv_nsec - start.tv_nsec) / 1000;
+
+    printf("%s", reply);
+    if (strncmp(reply, "OK", 2) == 0)
+        printf("Round trip: %lld us\n", micros);
+
+    return strncmp(reply, "OK", 2) == 0 || strncmp(reply, "requests", 8) == 0 ? 0 : 1;
+}
+
+//-------------------------- 6620501443 ปุญญพัฒน์ รักษ์ชูชีพ --------------------------//
@@ -3,16 +3,43 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <ctype.h>
+#include <time.h>
+#ifndef _WIN32
+#include <pthread.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#else
+#include <io.h>
+#endif
 
 // This constant can be avoided by explicitly
 // calculating height of Huffman Tree
 #define MAX_TREE_HT 100
 
+// Largest alphabet of the word and 16-bit symbol modes:
+// every 16-bit pair plus the single bytes used as fallback
+#define MAX_SYMBOLS (65536 + 256)
+// Longest word the tokenizer keeps as one symbol
+#define MAX_TOKEN_LEN 255
+// Slots in the token dictionary hash table (power of two)
+#define DICT_HASH_SIZE 262144
+
+// First two bytes of every file written by the new modes
+// (the "1001010111110000" pattern checked by the decompressor)
+#define HUFF_MAGIC_HI 0x95
+#define HUFF_MAGIC_LO 0xF0
+
 // A Huffman tree node
 struct MinHNode
 {
-    // One of the input characters
-    char item;
+    // One of the input characters (or a dictionary
+    // index in the word and 16-bit symbol modes)
+    int item;
     // Frequency of the character
     unsigned freq;
     // Left and right child of this node
@@ -34,7 +61,7 @@ struct MinHeap
 // A utility function allocate a new
 // min heap node with given character
 // and frequency of the character
-struct MinHNode *newNode(char item, unsigned freq)
+struct MinHNode *newNode(int item, unsigned freq)
 {
     struct MinHNode *temp = (struct MinHNode *)malloc(sizeof(struct MinHNode));
 
@@ -140,7 +167,7 @@ int isLeaf(struct MinHNode *root)
     return !(root->left) && !(root->right);
 }
 
-struct MinHeap *createAndBuildMinHeap(char item[], int freq[], int size)
+struct MinHeap *createAndBuildMinHeap(int item[], int freq[], int size)
 {
     struct MinHeap *minHeap = createMinH(size);
 
@@ -157,7 +184,7 @@ struct MinHeap *createAndBuildMinHeap(char item[], int freq[], int size)
 // equal to size and inserts all character of
 // data[] in min heap. Initially size of
 // min heap is equal to capacity
-struct MinHNode *buildHuffmanTree(char item[], int freq[], int size)
+struct MinHNode *buildHuffmanTree(int item[], int freq[], int size)
 {
     struct MinHNode *left, *right, *top;
     struct MinHeap *minHeap = createAndBuildMinHeap(item, freq, size);
@@ -174,7 +201,12 @@ struct MinHNode *buildHuffmanTree(char item[], int freq[], int size)
 
         insertMinHeap(minHeap, top);
     }
-    return extractMin(minHeap);
+
+    struct MinHNode *root = extractMin(minHeap);
+
+    free(minHeap->array);
+    free(minHeap);
+    return root;
 }
 // A utility function to print an array of size n
 void printArray(int arr[], int n);
@@ -201,7 +233,7 @@ void printHCodes(struct MinHNode *root, int arr[], int top,int freq[],char text[
 }
 void writeHuffmanCodes(struct MinHNode *root, int arr[], int top, int freq[], char text[]);
 // Wrapper function
-void HuffmanCodes(struct MinHNode *root,char item[],int freq[], int size,char text[])
+void HuffmanCodes(struct MinHNode *root,int item[],int freq[], int size,char text[])
 {
     struct MinHNode *root1 = buildHuffmanTree(item, freq, size);
 
@@ -381,12 +413,12 @@ void passSize(char *pass,int size)
     char bin[200]= {};
     intToBinary((char)size,bin,pass);
 }
-void password(char * item, int *freq,int size,char *pass)
+void password(int * item, int *freq,int size,char *pass)
 {
     char bin[2000]= {};
     for(int i=0; i<size; i++)
     {
-        intToBinary(item[i],bin,pass);
+        intToBinary((char)item[i],bin,pass);
         //printf("%s\n",pass);
     }
 }
@@ -412,15 +444,2063 @@ void Freq(int *freq,char *pass,int size)
         intToBinary((char)freq[i],bin,pass);
 }
 
-int main()
+// Read a whole file into memory, the length is returned in *len
+unsigned char *readWholeFile(const char *filename, size_t *len)
+{
+    FILE *file = fopen(filename, "rb");
+
+    if (file == NULL)
+    {
+        printf("Can't read file %s\n", filename);
+        return NULL;
+    }
+
+    // The size is only a first guess, pipes have none, so read to EOF
+    long size = fseek(file, 0, SEEK_END) == 0 ? ftell(file) : -1;
+    size_t cap = size > 0 ? (size_t)size + 1 : 65536;
+    unsigned char *buf = (unsigned char *)malloc(cap);
+
+    if (size >= 0)
+        rewind(file);
+    *len = 0;
+
+    while (buf != NULL)
+    {
+        *len += fread(buf + *len, 1, cap - *len, file);
+        if (*len < cap)
+            break;
+
+        unsigned char *grown = (unsigned char *)realloc(buf, cap * 2);
+
+        if (grown == NULL)
+        {
+            free(buf);
+            buf = NULL;
+        }
+        else
+        {
+            buf = grown;
+            cap *= 2;
+        }
+    }
+
+    if (buf == NULL || ferror(file))
+    {
+        printf("Can't read file %s\n", filename);
+        free(buf);
+        buf = NULL;
+    }
+
+    fclose(file);
+    return buf;
+}
+
+int writeWholeFile(const char *filename, const unsigned char *buf, size_t len)
+{
+    FILE *file = fopen(filename, "wb");
+
+    if (file == NULL)
+    {
+        printf("Error opening file %s\n", filename);
+        return 1;
+    }
+
+    fwrite(buf, 1, len, file);
+    fclose(file);
+    return 0;
+}
+
+// Packs codes MSB first into a growing byte buffer,
+// the same bit order binaryStringToFile uses
+struct BitWriter
+{
+    unsigned char *buf;
+    size_t cap;
+    size_t bytes;
+    unsigned long long acc;
+    int nbits;
+};
+
+void initBitWriter(struct BitWriter *bw, size_t cap)
+{
+    bw->cap = cap < 64 ? 64 : cap;
+    bw->buf = (unsigned char *)malloc(bw->cap);
+    bw->bytes = 0;
+    bw->acc = 0;
+    bw->nbits = 0;
+}
+
+// Empty the writer but keep its buffer
+void resetBitWriter(struct BitWriter *bw)
+{
+    bw->bytes = 0;
+    bw->acc = 0;
+    bw->nbits = 0;
+}
+
+// Append the low len bits of code (len <= 32)
+void putBits(struct BitWriter *bw, unsigned code, int len)
+{
+    if (bw->bytes + 8 > bw->cap)
+    {
+        bw->cap *= 2;
+        bw->buf = (unsigned char *)realloc(bw->buf, bw->cap);
+    }
+
+    bw->acc = (bw->acc << len) | (code & (unsigned)((1ULL << len) - 1));
+    bw->nbits += len;
+
+    while (bw->nbits >= 8)
+    {
+        bw->nbits -= 8;
+        bw->buf[bw->bytes++] = (unsigned char)(bw->acc >> bw->nbits);
+    }
+}
+
+// Append a Huffman code of any length
+void putCode(struct BitWriter *bw, unsigned long long code, int len)
+{
+    if (len > 32)
+    {
+        putBits(bw, (unsigned)(code >> 32), len - 32);
+        len = 32;
+    }
+    putBits(bw, (unsigned)code, len);
+}
+
+void putU32(struct BitWriter *bw, unsigned value)
+{
+    putBits(bw, value, 32);
+}
+
+// Pad the last byte with zero bits
+void flushBits(struct BitWriter *bw)
+{
+    if (bw->nbits > 0)
+        putBits(bw, 0, 8 - bw->nbits);
+}
+
+// Code and length of every symbol, filled from the tree
+struct CodeTable
+{
+    int size;
+    int count;
+    int maxLen;
+    unsigned long long *code;
+    unsigned char *len;
+};
+
+struct CodeTable *newCodeTable(int size)
+{
+    struct CodeTable *table = (struct CodeTable *)malloc(sizeof(struct CodeTable));
+
+    table->size = size;
+    table->count = 0;
+    table->maxLen = 0;
+    table->code = (unsigned long long *)calloc(size, sizeof(unsigned long long));
+    table->len = (unsigned char *)calloc(size, sizeof(unsigned char));
+
+    return table;
+}
+
+void freeCodeTable(struct CodeTable *table)
+{
+    free(table->code);
+    free(table->len);
+    free(table);
+}
+
+// Same walk as ownencode, but stores every code at once
+void buildCodeTable(struct MinHNode *root, unsigned long long code, int top, struct CodeTable *table)
+{
+    if (root->left)
+        buildCodeTable(root->left, code << 1, top + 1, table);
+
+    if (root->right)
+        buildCodeTable(root->right, (code << 1) | 1, top + 1, table);
+
+    if (isLeaf(root))
+    {
+        // A lone symbol still needs one bit per occurrence
+        int len = top ? top : 1;
+
+        table->code[root->item] = code;
+        table->len[root->item] = len;
+        table->count++;
+        if (len > table->maxLen)
+            table->maxLen = len;
+    }
+}
+
+// Token dictionary of the word and 16-bit symbol modes,
+// tokens point into the input buffer
+struct Dictionary
+{
+    int count;
+    const unsigned char *token[MAX_SYMBOLS];
+    unsigned char length[MAX_SYMBOLS];
+    int freq[MAX_SYMBOLS];
+    int slot[DICT_HASH_SIZE];
+};
+
+struct Dictionary *newDictionary()
+{
+    struct Dictionary *dict = (struct Dictionary *)malloc(sizeof(struct Dictionary));
+
+    dict->count = 0;
+    memset(dict->slot, -1, sizeof(dict->slot));
+
+    return dict;
+}
+
+// Find the token or add it, returns -1 once the
+// dictionary holds limit entries
+int addToken(struct Dictionary *dict, const unsigned char *text, int n, int limit)
+{
+    unsigned hash = 2166136261u;
+
+    for (int i = 0; i < n; i++)
+        hash = (hash ^ text[i]) * 16777619u;
+
+    unsigned s = hash & (DICT_HASH_SIZE - 1);
+
+    while (dict->slot[s] != -1)
+    {
+        int id = dict->slot[s];
+
+        if (dict->length[id] == n && memcmp(dict->token[id], text, n) == 0)
+            return id;
+        s = (s + 1) & (DICT_HASH_SIZE - 1);
+    }
+
+    if (dict->count >= limit)
+        return -1;
+
+    int id = dict->count++;
+
+    dict->token[id] = text;
+    dict->length[id] = n;
+    dict->freq[id] = 0;
+    dict->slot[s] = id;
+
+    return id;
+}
+
+// Split text into words (runs of letters and digits) plus single
+// bytes, or into 16-bit pairs. The ids go to ids[], the count is returned
+size_t tokenizeText(const unsigned char *text, size_t len, int wordMode, struct Dictionary *dict, int *ids)
+{
+    // Keep room for the 256 single bytes a full dictionary falls back to
+    int limit = MAX_SYMBOLS - 256;
+    size_t count = 0;
+    size_t i = 0;
+
+    while (i < len)
+    {
+        int n = 1;
+
+        if (!wordMode)
+            n = (i + 1 < len) ? 2 : 1;
+        else if (isalnum(text[i]))
+        {
+            while (i + n < len && n < MAX_TOKEN_LEN && isalnum(text[i + n]))
+                n++;
+        }
+
+        int id = addToken(dict, text + i, n, n > 1 ? limit : MAX_SYMBOLS);
+
+        if (id < 0)
+        {
+            // Dictionary is full, spell the token out byte by byte
+            for (int k = 0; k < n; k++)
+            {
+                id = addToken(dict, text + i + k, 1, MAX_SYMBOLS);
+                dict->freq[id]++;
+                ids[count++] = id;
+            }
+        }
+        else
+        {
+            dict->freq[id]++;
+            ids[count++] = id;
+        }
+        i += n;
+    }
+
+    return count;
+}
+
+// Free a tree returned by buildHuffmanTree
+void freeHuffmanTree(struct MinHNode *root)
 {
+    if (root == NULL)
+        return;
+
+    freeHuffmanTree(root->left);
+    freeHuffmanTree(root->right);
+    free(root);
+}
+
+// Word ('W') or 16-bit symbol ('S') alphabet. Layout:
+// magic, mode, dictionary size, (length, bytes, frequency) per
+// entry, token count, then the codes of all tokens
+int compressWide(const char *inName, const char *outName, int wordMode)
+{
+    size_t len;
+    unsigned char *text = readWholeFile(inName, &len);
+
+    if (text == NULL)
+        return 1;
+
+    struct Dictionary *dict = newDictionary();
+    int *ids = (int *)malloc((len + 1) * sizeof(int));
+    size_t count = tokenizeText(text, len, wordMode, dict, ids);
+
+    struct BitWriter bw;
+    initBitWriter(&bw, len / 2 + 1024);
+
+    putBits(&bw, HUFF_MAGIC_HI, 8);
+    putBits(&bw, HUFF_MAGIC_LO, 8);
+    putBits(&bw, wordMode ? 'W' : 'S', 8);
+    putU32(&bw, dict->count);
+
+    for (int i = 0; i < dict->count; i++)
+    {
+        putBits(&bw, dict->length[i], 8);
+        for (int k = 0; k < dict->length[i]; k++)
+            putBits(&bw, dict->token[i][k], 8);
+        putU32(&bw, dict->freq[i]);
+    }
+    putU32(&bw, (unsigned)count);
+
+    if (dict->count > 0)
+    {
+        int *items = (int *)malloc(dict->count * sizeof(int));
+
+        for (int i = 0; i < dict->count; i++)
+            items[i] = i;
+
+        struct MinHNode *root = buildHuffmanTree(items, dict->freq, dict->count);
+        struct CodeTable *table = newCodeTable(dict->count);
+
+        buildCodeTable(root, 0, 0, table);
+
+        for (size_t i = 0; i < count; i++)
+            putCode(&bw, table->code[ids[i]], table->len[ids[i]]);
+
+        printf("Symbols: %d  Longest code: %d bits\n", dict->count, table->maxLen);
+        freeCodeTable(table);
+        freeHuffmanTree(root);
+        free(items);
+    }
+    flushBits(&bw);
+
+    int result = writeWholeFile(outName, bw.buf, bw.bytes);
+
+    printf("Tokens: %zu  Input: %zu bytes  Output: %zu bytes\n", count, len, bw.bytes);
+
+    free(bw.buf);
+    free(ids);
+    free(dict);
+    free(text);
+    return result;
+}
+
+// log2(x) in 1/256 bit units, without libm
+unsigned log2Fixed(unsigned x)
+{
+    unsigned e = 0;
+
+    while ((x >> e) > 1)
+        e++;
+
+    // Mantissa in [1,2) as 16.16, each squaring gives one more bit
+    unsigned long long m = ((unsigned long long)x << 16) >> e;
+    unsigned frac = 0;
+
+    for (int i = 0; i < 8; i++)
+    {
+        m = (m * m) >> 16;
+        frac <<= 1;
+        if (m >= (2u << 16))
+        {
+            m >>= 1;
+            frac |= 1;
+        }
+    }
+
+    return (e << 8) | frac;
+}
+
+#include "Huffman_code_Block.h"
+
+// Bytes per block in block mode
+#define BLOCK_SIZE 65536
+
+// Longest combined code a pair table entry may hold
+#define PAIR_MAX_BITS 32
+// Pair tables are only built for tables whose codes are this short
+#define PAIR_MAX_CODE 24
+
+// Codes of two bytes at once, indexed by first << 8 | second.
+// len is 0 when the pair doesn't fit in PAIR_MAX_BITS
+struct PairTable
+{
+    int ready;
+    unsigned code[65536];
+    unsigned char len[65536];
+};
+
+// Per stream state of the block encoder. The cache slots are
+// filled round robin, the decoder repeats the same order
+struct BlockEncoder
+{
+    struct CodeTable *cache[TABLE_CACHE_SIZE];
+    struct PairTable *pairs[TABLE_CACHE_SIZE];
+    int cacheCount;
+    int cacheNext;
+    int blocksNew;
+    int blocksReused;
+    int blocksPaired;
+    int blocksFixed;
+    int blocksDuplicate;
+};
+
+void initBlockEncoder(struct BlockEncoder *enc)
+{
+    for (int i = 0; i < TABLE_CACHE_SIZE; i++)
+    {
+        enc->cache[i] = newCodeTable(256);
+        enc->pairs[i] = NULL;
+    }
+
+    enc->cacheCount = 0;
+    enc->cacheNext = 0;
+    enc->blocksNew = 0;
+    enc->blocksReused = 0;
+    enc->blocksPaired = 0;
+    enc->blocksFixed = 0;
+    enc->blocksDuplicate = 0;
+}
+
+// Forget the cached tables before the next stream
+void resetBlockEncoder(struct BlockEncoder *enc)
+{
+    for (int i = 0; i < TABLE_CACHE_SIZE; i++)
+    {
+        if (enc->pairs[i] != NULL)
+            enc->pairs[i]->ready = 0;
+    }
+
+    enc->cacheCount = 0;
+    enc->cacheNext = 0;
+    enc->blocksNew = 0;
+    enc->blocksReused = 0;
+    enc->blocksPaired = 0;
+    enc->blocksFixed = 0;
+    enc->blocksDuplicate = 0;
+}
+
+void freeBlockEncoder(struct BlockEncoder *enc)
+{
+    for (int i = 0; i < TABLE_CACHE_SIZE; i++)
+    {
+        freeCodeTable(enc->cache[i]);
+        free(enc->pairs[i]);
+    }
+}
+
+// Fill the pair entries of every two symbols the table codes
+void buildPairTable(struct CodeTable *table, struct PairTable *pairs)
+{
+    int present[256], n = 0;
+
+    for (int i = 0; i < 256; i++)
+    {
+        if (table->len[i] != 0)
+            present[n++] = i;
+    }
+
+    for (int a = 0; a < n; a++)
+    {
+        int first = present[a];
+
+        for (int b = 0; b < n; b++)
+        {
+            int second = present[b];
+            int len = table->len[first] + table->len[second];
+            int idx = (first << 8) | second;
+
+            if (len > PAIR_MAX_BITS)
+                pairs->len[idx] = 0;
+            else
+            {
+                pairs->code[idx] = (unsigned)((table->code[first] << table->len[second]) | table->code[second]);
+                pairs->len[idx] = len;
+            }
+        }
+    }
+    pairs->ready = 1;
+}
+
+// Pair tables cost count * count entries to fill, so only use
+// them for blocks long enough to pay that back (or already built)
+struct PairTable *selectPairTable(struct BlockEncoder *enc, int slot, size_t len)
+{
+    struct CodeTable *table = enc->cache[slot];
+    struct PairTable *pairs = enc->pairs[slot];
+
+    if (pairs != NULL && pairs->ready)
+        return pairs;
+
+    if (table->maxLen > PAIR_MAX_CODE || (size_t)table->count * table->count > len)
+        return NULL;
+
+    if (pairs == NULL)
+        pairs = enc->pairs[slot] = (struct PairTable *)malloc(sizeof(struct PairTable));
+
+    buildPairTable(table, pairs);
+    return pairs;
+}
+
+// Bits needed to code the histogram with a table,
+// or -1 when the table lacks one of its symbols
+long long tableCost(struct CodeTable *table, unsigned hist[256])
+{
+    long long bits = 0;
+
+    for (int i = 0; i < 256; i++)
+    {
+        if (hist[i] == 0)
+            continue;
+        if (table->len[i] == 0)
+            return -1;
+        bits += (long long)hist[i] * table->len[i];
+    }
+
+    return bits;
+}
+
+// A real Huffman code spends about this fraction of a bit
+// per byte more than the entropy of its block
+#define HUFFMAN_SLACK 64
+
+// Estimated bits to code the block with its own tree: the entropy of
+// the histogram, the usual Huffman redundancy on top (a tree never
+// spends less than one bit per byte) and the header of the new table
+long long freshCost(unsigned hist[256], size_t len)
+{
+    unsigned logTotal = log2Fixed((unsigned)len);
+    long long bits = 0;
+    int count = 0;
+
+    for (int i = 0; i < 256; i++)
+    {
+        if (hist[i] == 0)
+            continue;
+        bits += (long long)hist[i] * (logTotal - log2Fixed(hist[i]));
+        count++;
+    }
+
+    bits = (bits >> 8) + len / HUFFMAN_SLACK;
+    if (bits < (long long)len)
+        bits = len;
+
+    return bits + 8 + count * 40;
+}
+
+void patchU32(unsigned char *p, unsigned value)
+{
+    p[0] = value >> 24;
+    p[1] = value >> 16;
+    p[2] = value >> 8;
+    p[3] = value;
+}
+
+// Build the code table of a new 'N' record into a cache slot
+struct CodeTable *fillCacheSlot(struct BlockEncoder *enc, int slot, int item[], int freq[], int size)
+{
+    struct CodeTable *table = enc->cache[slot];
+
+    memset(table->len, 0, 256);
+    table->count = 0;
+    table->maxLen = 0;
+    if (enc->pairs[slot] != NULL)
+        enc->pairs[slot]->ready = 0;
+
+    struct MinHNode *root = buildHuffmanTree(item, freq, size);
+    buildCodeTable(root, 0, 0, table);
+    freeHuffmanTree(root);
+
+    return table;
+}
+
+// Alphabets up to this size may be packed at a fixed width
+#define SMALL_ALPHABET 16
+
+// Room for n raw bytes after a flushed writer
+unsigned char *reserveBytes(struct BitWriter *bw, size_t n)
+{
+    while (bw->bytes + n + 8 > bw->cap)
+    {
+        bw->cap *= 2;
+        bw->buf = (unsigned char *)realloc(bw->buf, bw->cap);
+    }
+
+    return bw->buf + bw->bytes;
+}
+
+// Pack the symbol index of every byte at 1, 2 or 4 bits, MSB first.
+// The loops are unrolled so each output byte is one straight expression
+void packFixed(const unsigned char *data, size_t len, const unsigned char map[256], int width, unsigned char *out)
+{
+    int per = 8 / width;
+    size_t full = len / per;
+    const unsigned char *p = data;
+
+    switch (width)
+    {
+    case 1:
+        for (size_t k = 0; k < full; k++, p += 8)
+            out[k] = (map[p[0]] << 7) | (map[p[1]] << 6) | (map[p[2]] << 5) | (map[p[3]] << 4)
+                     | (map[p[4]] << 3) | (map[p[5]] << 2) | (map[p[6]] << 1) | map[p[7]];
+        break;
+    case 2:
+        for (size_t k = 0; k < full; k++, p += 4)
+            out[k] = (map[p[0]] << 6) | (map[p[1]] << 4) | (map[p[2]] << 2) | map[p[3]];
+        break;
+    default:
+        for (size_t k = 0; k < full; k++, p += 2)
+            out[k] = (map[p[0]] << 4) | map[p[1]];
+    }
+
+    if (full * per < len)
+    {
+        unsigned char last = 0;
+
+        for (int i = 0; full * per + i < len; i++)
+            last |= map[p[i]] << (8 - width * (i + 1));
+        out[full] = last;
+    }
+}
+
+// 'F' record: count - 1, the symbols, raw length, payload length and the
+// symbol indexes packed at the narrowest of 1, 2 or 4 bits
+void encodeFixedBlock(struct BlockEncoder *enc, const unsigned char *data, size_t len,
+                      unsigned hist[256], int width, struct BitWriter *bw)
+{
+    unsigned char map[256] = {0};
+    int count = 0;
+
+    putBits(bw, 'F', 8);
+    for (int i = 0; i < 256; i++)
+    {
+        if (hist[i] != 0)
+            map[i] = count++;
+    }
+
+    putBits(bw, count - 1, 8);
+    for (int i = 0; i < 256; i++)
+    {
+        if (hist[i] != 0)
+            putBits(bw, i, 8);
+    }
+
+    size_t payload = (len * width + 7) / 8;
+
+    putU32(bw, (unsigned)len);
+    putU32(bw, (unsigned)payload);
+    packFixed(data, len, map, width, reserveBytes(bw, payload));
+    bw->bytes += payload;
+    enc->blocksFixed++;
+}
+
+// One block record: 'N' with a new table (count - 1, then symbol and
+// frequency pairs) or 'R' with a cache slot, then raw length,
+// payload length and the byte aligned payload. Tiny alphabets may
+// become an 'F' record instead
+void encodeBlock(struct BlockEncoder *enc, const unsigned char *data, size_t len, struct BitWriter *bw)
+{
+    unsigned hist[256] = {0};
+
+    for (size_t i = 0; i < len; i++)
+        hist[data[i]]++;
+
+    // Cheapest cached table, if any covers the block
+    long long best = -1;
+    int slot = -1;
+
+    for (int k = 0; k < enc->cacheCount; k++)
+    {
+        long long bits = tableCost(enc->cache[k], hist);
+
+        if (bits >= 0 && (best < 0 || bits < best))
+        {
+            best = bits;
+            slot = k;
+        }
+    }
+
+    long long fresh = freshCost(hist, len);
+    int distinct = 0;
+
+    for (int i = 0; i < 256; i++)
+        distinct += hist[i] != 0;
+
+    // Tiny alphabets skip the tree when fixed width packing is
+    // within 1/16 bit per byte of the best Huffman estimate
+    if (distinct <= SMALL_ALPHABET)
+    {
+        int width = distinct <= 2 ? 1 : distinct <= 4 ? 2 : 4;
+        long long fixed = (long long)len * width + 8 + distinct * 8;
+        long long huffman = slot >= 0 && best + 8 < fresh ? best + 8 : fresh;
+
+        if (fixed <= huffman + (long long)(len / 16))
+        {
+            encodeFixedBlock(enc, data, len, hist, width, bw);
+            return;
+        }
+    }
+
+    struct CodeTable *table;
+
+    if (slot >= 0 && best + 8 <= fresh)
+    {
+        table = enc->cache[slot];
+        putBits(bw, 'R', 8);
+        putBits(bw, slot, 8);
+        enc->blocksReused++;
+    }
+    else
+    {
+        int item[256], freq[256], size = 0;
+
+        for (int i = 0; i < 256; i++)
+        {
+            if (hist[i] != 0)
+            {
+                item[size] = i;
+                freq[size] = hist[i];
+                size++;
+            }
+        }
+
+        slot = enc->cacheNext;
+        table = fillCacheSlot(enc, slot, item, freq, size);
+
+        putBits(bw, 'N', 8);
+        putBits(bw, size - 1, 8);
+        for (int i = 0; i < size; i++)
+        {
+            putBits(bw, item[i], 8);
+            putU32(bw, freq[i]);
+        }
+
+        enc->cacheNext = (enc->cacheNext + 1) % TABLE_CACHE_SIZE;
+        if (enc->cacheCount < TABLE_CACHE_SIZE)
+            enc->cacheCount++;
+        enc->blocksNew++;
+    }
+
+    putU32(bw, (unsigned)len);
+    size_t lenPos = bw->bytes;
+    putU32(bw, 0);
+
+    struct PairTable *pairs = selectPairTable(enc, slot, len);
+    size_t i = 0;
+
+    if (pairs != NULL)
+    {
+        // Two bytes per lookup, pairs too long for one entry
+        // fall back to the single codes
+        for (; i + 1 < len; i += 2)
+        {
+            unsigned idx = (data[i] << 8) | data[i + 1];
+
+            if (pairs->len[idx])
+                putBits(bw, pairs->code[idx], pairs->len[idx]);
+            else
+            {
+                putCode(bw, table->code[data[i]], table->len[data[i]]);
+                putCode(bw, table->code[data[i + 1]], table->len[data[i + 1]]);
+            }
+        }
+        enc->blocksPaired++;
+    }
+
+    for (; i < len; i++)
+        putCode(bw, table->code[data[i]], table->len[data[i]]);
+    flushBits(bw);
+
+    patchU32(bw->buf + lenPos, (unsigned)(bw->bytes - lenPos - 4));
+}
+
+// Index entry of one block in a 'B' file
+struct BlockEntry
+{
+    // Marker of the block's record ('N', 'R' or 'F'),
+    // or 'D' for a repeat of an earlier block
+    char kind;
+    unsigned rawLen;
+    unsigned long long hash;
+    // Record offset in the file, or the block number it repeats
+    unsigned long long value;
+};
+
+// Fast non-cryptographic 64-bit hash of a block
+unsigned long long blockHash(const unsigned char *p, size_t len)
+{
+    unsigned long long h = 0x9E3779B97F4A7C15ULL ^ len;
+    size_t i = 0;
+
+    for (; i + 8 <= len; i += 8)
+    {
+        unsigned long long v;
+
+        memcpy(&v, p + i, 8);
+        h = (h ^ v) * 0xFF51AFD7ED558CCDULL;
+        h ^= h >> 32;
+    }
+
+    for (; i < len; i++)
+        h = (h ^ p[i]) * 0x100000001B3ULL;
+
+    h ^= h >> 29;
+    h *= 0xC4CEB9FE1A85EC53ULL;
+    h ^= h >> 32;
+    return h;
+}
+
+void putU64(struct BitWriter *bw, unsigned long long value)
+{
+    putU32(bw, (unsigned)(value >> 32));
+    putU32(bw, (unsigned)value);
+}
+
+// Encode blocks first..count-1 and fill their index entries. A block
+// whose hash, length and bytes match an earlier stored block gets a
+// 'D' entry and no record. Entries before first are already written,
+// base is the file offset of the writer's first byte
+void encodeBlocks(struct BlockEncoder *enc, const unsigned char *text, size_t *ends, size_t first,
+                  size_t count, struct BlockEntry *entries, unsigned long long base, struct BitWriter *bw)
+{
+    size_t slots = 16;
+
+    while (slots < count * 2)
+        slots <<= 1;
+
+    long *seen = (long *)malloc(slots * sizeof(long));
+
+    for (size_t i = 0; i < slots; i++)
+        seen[i] = -1;
+
+    for (size_t b = 0; b < count; b++)
+    {
+        size_t start = b ? ends[b - 1] : 0;
+        size_t len = ends[b] - start;
+
+        if (b >= first)
+        {
+            entries[b].rawLen = (unsigned)len;
+            entries[b].hash = blockHash(text + start, len);
+        }
+
+        size_t s = entries[b].hash & (slots - 1);
+        long match = -1;
+
+        while (seen[s] != -1)
+        {
+            long j = seen[s];
+            size_t jStart = j ? ends[j - 1] : 0;
+
+            if (entries[j].hash == entries[b].hash && entries[j].rawLen == len
+                && memcmp(text + jStart, text + start, len) == 0)
+            {
+                match = j;
+                break;
+            }
+            s = (s + 1) & (slots - 1);
+        }
+
+        if (b < first)
+        {
+            if (match < 0 && entries[b].kind != 'D')
+                seen[s] = (long)b;
+            continue;
+        }
+
+        if (match >= 0)
+        {
+            entries[b].kind = 'D';
+            entries[b].value = match;
+            enc->blocksDuplicate++;
+        }
+        else
+        {
+            size_t record = bw->bytes;
+
+            encodeBlock(enc, text + start, len, bw);
+            entries[b].kind = bw->buf[record];
+            entries[b].value = base + record;
+            seen[s] = (long)b;
+        }
+    }
+
+    free(seen);
+}
+
+// Index after the last record: kind, raw length, hash and value of every
+// block, then the index offset and block count
+void writeBlockIndex(struct BlockEntry *entries, size_t count, unsigned long long base, struct BitWriter *bw)
+{
+    unsigned long long indexOffset = base + bw->bytes;
+
+    for (size_t b = 0; b < count; b++)
+    {
+        putBits(bw, entries[b].kind, 8);
+        putU32(bw, entries[b].rawLen);
+        putU64(bw, entries[b].hash);
+        putU64(bw, entries[b].value);
+    }
+
+    putU64(bw, indexOffset);
+    putU32(bw, (unsigned)count);
+}
+
+// Block mode ('B'): magic, mode, longest block (with ADAPTIVE_BLOCKS
+// for -a files), one record per stored block and the block index.
+// ends[] holds the end offset of every block
+void encodeBlockStream(struct BlockEncoder *enc, const unsigned char *text, size_t *ends,
+                       size_t count, size_t maxBlock, struct BitWriter *bw)
+{
+    struct BlockEntry *entries = (struct BlockEntry *)malloc((count + 1) * sizeof(struct BlockEntry));
+
+    putBits(bw, HUFF_MAGIC_HI, 8);
+    putBits(bw, HUFF_MAGIC_LO, 8);
+    putBits(bw, 'B', 8);
+    putU32(bw, (unsigned)maxBlock);
+
+    encodeBlocks(enc, text, ends, 0, count, entries, 0, bw);
+    writeBlockIndex(entries, count, 0, bw);
+
+    free(entries);
+}
+
+// Cut every blockSize bytes, returns the number of blocks
+size_t fixedBlockEnds(size_t len, size_t blockSize, size_t **ends)
+{
+    size_t count = 0;
+
+    *ends = (size_t *)malloc((len / blockSize + 1) * sizeof(size_t));
+
+    for (size_t i = 0; i < len; i += blockSize)
+        (*ends)[count++] = len - i < blockSize ? len : i + blockSize;
+
+    return count;
+}
+
+// Bytes scanned per step of the split search
+#define SPLIT_CHUNK 4096
+// Only every SPLIT_SAMPLE-th byte goes into the split histograms
+#define SPLIT_SAMPLE 4
+// Longest block the split search makes
+#define MAX_SEGMENT (1 << 20)
+
+// log2(x) with 16 fraction bits, finer than log2Fixed for the
+// split search where the rounding adds up over large histograms
+unsigned long long log2Fine(unsigned x)
+{
+    unsigned e = 0;
+
+    while ((x >> e) > 1)
+        e++;
+
+    // Mantissa in [1,2) as 2.30
+    unsigned long long m = ((unsigned long long)x << 30) >> e;
+    unsigned long long frac = 0;
+
+    for (int i = 0; i < 16; i++)
+    {
+        m = (m * m) >> 30;
+        frac <<= 1;
+        if (m >= (2ull << 30))
+        {
+            m >>= 1;
+            frac |= 1;
+        }
+    }
+
+    return ((unsigned long long)e << 16) | frac;
+}
+
+// Entropy of a histogram in bits
+long long histogramCost(unsigned hist[256], unsigned total)
+{
+    unsigned long long logTotal = log2Fine(total);
+    long long bits = 0;
+    int symbols = 0;
+
+    for (int i = 0; i < 256; i++)
+    {
+        if (hist[i] != 0)
+        {
+            bits += (long long)(hist[i] * (logTotal - log2Fine(hist[i])));
+            symbols++;
+        }
+    }
+
+    // Sampled counts make the entropy come out low by about
+    // (symbols - 1) / (2 ln 2) bits, most of all for a lone chunk
+    return (bits >> 16) + (symbols > 1 ? (symbols - 1) * 185 / 256 : 0);
+}
+
+// Cut where the byte distribution changes. Each chunk either joins the
+// current block or starts a new one, whichever the sampled histograms
+// say is cheaper once the new block's table header is paid for
+size_t adaptiveBlockEnds(const unsigned char *text, size_t len, size_t **ends)
+{
+    unsigned seg[256] = {0};
+    unsigned segTotal = 0;
+    size_t start = 0;
+    size_t count = 0;
+
+    *ends = (size_t *)malloc((len / SPLIT_CHUNK + 2) * sizeof(size_t));
+
+    for (size_t pos = 0; pos < len; pos += SPLIT_CHUNK)
+    {
+        size_t end = len - pos < SPLIT_CHUNK ? len : pos + SPLIT_CHUNK;
+        unsigned chunk[256] = {0};
+        unsigned chunkTotal = 0;
+        int chunkSymbols = 0;
+
+        for (size_t i = pos; i < end; i += SPLIT_SAMPLE)
+        {
+            chunkSymbols += chunk[text[i]] == 0;
+            chunk[text[i]]++;
+            chunkTotal++;
+        }
+
+        if (segTotal > 0)
+        {
+            int split = end - start > MAX_SEGMENT;
+
+            if (!split)
+            {
+                unsigned merged[256];
+
+                for (int i = 0; i < 256; i++)
+                    merged[i] = seg[i] + chunk[i];
+
+                long long apart = (histogramCost(seg, segTotal) + histogramCost(chunk, chunkTotal)) * SPLIT_SAMPLE
+                                  + 16 + chunkSymbols * 40;
+                long long together = histogramCost(merged, segTotal + chunkTotal) * SPLIT_SAMPLE;
+
+                split = apart < together;
+            }
+
+            if (split)
+            {
+                (*ends)[count++] = pos;
+                start = pos;
+                memset(seg, 0, sizeof(seg));
+                segTotal = 0;
+            }
+        }
+
+        for (int i = 0; i < 256; i++)
+            seg[i] += chunk[i];
+        segTotal += chunkTotal;
+    }
+
+    if (len > 0)
+        (*ends)[count++] = len;
+
+    return count;
+}
+
+// Fixed blocks of blockSize bytes, or blocks cut by
+// adaptiveBlockEnds when blockSize is 0
+int compressBlocks(const char *inName, const char *outName, size_t blockSize)
+{
+    size_t len;
+    unsigned char *text = readWholeFile(inName, &len);
+
+    if (text == NULL)
+        return 1;
+
+    size_t *ends;
+    size_t count;
+    size_t maxBlock = blockSize;
+
+    if (blockSize == 0)
+    {
+        clock_t start = clock();
+
+        count = adaptiveBlockEnds(text, len, &ends);
+        for (size_t b = 0; b < count; b++)
+        {
+            size_t blockLen = ends[b] - (b > 0 ? ends[b - 1] : 0);
+
+            if (blockLen > maxBlock)
+                maxBlock = blockLen;
+        }
+        printf("Split pass: %zu blocks in %.2f ms\n", count, (clock() - start) * 1000.0 / CLOCKS_PER_SEC);
+    }
+    else
+        count = fixedBlockEnds(len, blockSize, &ends);
+
+    struct BlockEncoder enc;
+    struct BitWriter bw;
+
+    initBlockEncoder(&enc);
+    initBitWriter(&bw, len / 2 + 1024);
+
+    encodeBlockStream(&enc, text, ends, count, blockSize == 0 ? maxBlock | ADAPTIVE_BLOCKS : maxBlock, &bw);
+
+    int result = writeWholeFile(outName, bw.buf, bw.bytes);
+
+    printf("Blocks: %d new table, %d reused, %d pair coded, %d fixed width, %d duplicate  Input: %zu bytes  Output: %zu bytes\n",
+           enc.blocksNew, enc.blocksReused, enc.blocksPaired, enc.blocksFixed, enc.blocksDuplicate, len, bw.bytes);
+
+    freeBlockEncoder(&enc);
+    free(bw.buf);
+    free(ends);
+    free(text);
+    return result;
+}
+
+// Put the encoder cache back as it stood after the first keep blocks
+// of an existing file, from the 'N' records that are still cached
+int replayTableCache(struct BlockEncoder *enc, FILE *file, struct BlockEntry *entries, size_t keep)
+{
+    int tables = 0;
+    int seen = 0;
+
+    for (size_t b = 0; b < keep; b++)
+        tables += entries[b].kind == 'N';
+
+    resetBlockEncoder(enc);
+
+    for (size_t b = 0; b < keep; b++)
+    {
+        if (entries[b].kind != 'N' || ++seen <= tables - TABLE_CACHE_SIZE)
+            continue;
+
+        unsigned char record[2 + 256 * 5];
+        int item[256], freq[256];
+
+        fseek(file, (long)entries[b].value, SEEK_SET);
+        if (fread(record, 1, 2, file) != 2 || record[0] != 'N')
+            return 1;
+
+        int size = record[1] + 1;
+
+        if (fread(record + 2, 5, size, file) != (size_t)size)
+            return 1;
+
+        for (int i = 0; i < size; i++)
+        {
+            const unsigned char *p = record + 2 + i * 5;
+
+            item[i] = p[0];
+            freq[i] = (int)(((unsigned)p[1] << 24) | ((unsigned)p[2] << 16) | ((unsigned)p[3] << 8) | p[4]);
+        }
+        fillCacheSlot(enc, (seen - 1) % TABLE_CACHE_SIZE, item, freq, size);
+    }
+
+    enc->cacheNext = tables % TABLE_CACHE_SIZE;
+    enc->cacheCount = tables < TABLE_CACHE_SIZE ? tables : TABLE_CACHE_SIZE;
+    return 0;
+}
+
+// Read the header block size and the index of a 'B' file,
+// returns the number of blocks or -1 if it isn't one
+long readBlockIndex(FILE *file, size_t *maxBlock, unsigned long long *indexOffset, struct BlockEntry **entries)
+{
+    unsigned char head[12];
+
+    fseek(file, 0, SEEK_END);
+    long size = ftell(file);
+
+    rewind(file);
+    if (size < 19 || fread(head, 1, 7, file) != 7 || head[0] != HUFF_MAGIC_HI || head[1] != HUFF_MAGIC_LO
+        || head[2] != 'B')
+        return -1;
+
+    *maxBlock = ((size_t)head[3] << 24) | ((size_t)head[4] << 16) | ((size_t)head[5] << 8) | head[6];
+
+    fseek(file, size - 12, SEEK_SET);
+    if (fread(head, 1, 12, file) != 12)
+        return -1;
+
+    *indexOffset = getU64(head);
+    long count = ((long)head[8] << 24) | ((long)head[9] << 16) | ((long)head[10] << 8) | head[11];
+
+    if (*maxBlock == 0 || *indexOffset < 7 || *indexOffset + count * 21 + 12 != (unsigned long long)size)
+        return -1;
+
+    *entries = (struct BlockEntry *)malloc((count + 1) * sizeof(struct BlockEntry));
+    fseek(file, (long)*indexOffset, SEEK_SET);
+
+    for (long b = 0; b < count; b++)
+    {
+        unsigned char entry[21];
+
+        if (fread(entry, 1, 21, file) != 21)
+        {
+            free(*entries);
+            return -1;
+        }
+        (*entries)[b].kind = entry[0];
+        (*entries)[b].rawLen = ((unsigned)entry[1] << 24) | ((unsigned)entry[2] << 16) | ((unsigned)entry[3] << 8) | entry[4];
+        (*entries)[b].hash = getU64(entry + 5);
+        (*entries)[b].value = getU64(entry + 13);
+    }
+
+    return count;
+}
+
+// Append mode for a growing input. Every block of the existing output but
+// the last (which may be partial) is kept once its checksum matches the
+// input. Only the rest is encoded, cut the way the file was (fixed size,
+// or adaptiveBlockEnds for -a files), written over the old index, and the
+// index is rewritten. Anything that doesn't match is compressed again.
+// A missing output is compressed afresh, any other file is left alone
+int compressAppend(const char *inName, const char *outName)
+{
+    FILE *file = fopen(outName, "r+b");
+    struct BlockEntry *entries = NULL;
+    size_t maxBlock = BLOCK_SIZE;
+    unsigned long long indexOffset;
+    unsigned char magic[3];
+
+    if (file == NULL)
+        return compressBlocks(inName, outName, BLOCK_SIZE);
+
+    if (fread(magic, 1, 3, file) != 3 || magic[0] != HUFF_MAGIC_HI || magic[1] != HUFF_MAGIC_LO || magic[2] != 'B')
+    {
+        printf("%s is not a block mode file, not overwriting it\n", outName);
+        fclose(file);
+        return 1;
+    }
+
+    long count = readBlockIndex(file, &maxBlock, &indexOffset, &entries);
+    int adaptive = (maxBlock & ADAPTIVE_BLOCKS) != 0;
+    size_t blockSize = adaptive ? 0 : maxBlock;
+
+    if (count < 0)
+    {
+        printf("No block index in %s, compressing from the start\n", outName);
+        fclose(file);
+        return compressBlocks(inName, outName, blockSize > 0 || adaptive ? blockSize : BLOCK_SIZE);
+    }
+
+    size_t len;
+    unsigned char *text = readWholeFile(inName, &len);
+
+    if (text == NULL)
+    {
+        fclose(file);
+        free(entries);
+        return 1;
+    }
+
+    size_t keep = count > 0 ? count - 1 : 0;
+    size_t prefix = 0;
+    int match = 1;
+
+    for (size_t b = 0; b < keep && match; b++)
+    {
+        match = prefix + entries[b].rawLen <= len
+                && blockHash(text + prefix, entries[b].rawLen) == entries[b].hash;
+        prefix += entries[b].rawLen;
+    }
+
+    if (!match)
+    {
+        printf("Input no longer matches %s, compressing from the start\n", outName);
+        fclose(file);
+        free(entries);
+        free(text);
+        return compressBlocks(inName, outName, blockSize);
+    }
+
+    // New records go where the dropped last block's record (or the index) was
+    unsigned long long cut = indexOffset;
+
+    if (count > 0 && entries[count - 1].kind != 'D')
+        cut = entries[count - 1].value;
+
+    size_t *tail;
+    size_t tailCount = adaptive ? adaptiveBlockEnds(text + prefix, len - prefix, &tail)
+                                : fixedBlockEnds(len - prefix, blockSize, &tail);
+    size_t total = keep + tailCount;
+    size_t *ends = (size_t *)malloc((total + 1) * sizeof(size_t));
+
+    entries = (struct BlockEntry *)realloc(entries, (total + 1) * sizeof(struct BlockEntry));
+    for (size_t b = 0, end = 0; b < keep; b++)
+        ends[b] = end += entries[b].rawLen;
+    for (size_t b = 0; b < tailCount; b++)
+        ends[keep + b] = prefix + tail[b];
+
+    struct BlockEncoder enc;
+    struct BitWriter bw;
+    int result = 0;
+
+    initBlockEncoder(&enc);
+    initBitWriter(&bw, (len - prefix) / 2 + 1024);
+
+    if (replayTableCache(&enc, file, entries, keep) != 0)
+    {
+        printf("Can't read the tables of %s\n", outName);
+        result = 1;
+    }
+    else
+    {
+        encodeBlocks(&enc, text, ends, keep, total, entries, cut, &bw);
+        writeBlockIndex(entries, total, cut, &bw);
+
+        fseek(file, (long)cut, SEEK_SET);
+        int written = fwrite(bw.buf, 1, bw.bytes, file) == bw.bytes;
+
+        // The longest block of an adaptive file may have changed
+        if (adaptive && written)
+        {
+            unsigned longest = 0;
+            unsigned char head[4];
+
+            for (size_t b = 0; b < total; b++)
+                longest = entries[b].rawLen > longest ? entries[b].rawLen : longest;
+            longest |= ADAPTIVE_BLOCKS;
+            for (int i = 0; i < 4; i++)
+                head[i] = (unsigned char)(longest >> (24 - 8 * i));
+            fseek(file, 3, SEEK_SET);
+            written = fwrite(head, 1, 4, file) == 4;
+        }
+
+        written = written && fflush(file) == 0;
+#ifndef _WIN32
+        written = written && ftruncate(fileno(file), (off_t)(cut + bw.bytes)) == 0;
+#else
+        written = written && _chsize(_fileno(file), (long)(cut + bw.bytes)) == 0;
+#endif
+        if (!written)
+        {
+            printf("Can't write %s, it may be damaged\n", outName);
+            result = 1;
+        }
+        else
+            printf("Kept %zu blocks, encoded %zu  Input: %zu bytes  Written: %zu bytes\n",
+                   keep, tailCount, len, bw.bytes);
+    }
+
+    if (fclose(file) != 0)
+        result = 1;
+    freeBlockEncoder(&enc);
+    free(bw.buf);
+    free(ends);
+    free(tail);
+    free(entries);
+    free(text);
+    return result;
+}
+
+#ifndef _WIN32
+// Resident compression service on a UNIX domain socket. One request
+// per connection, fields separated by tabs and ended by a newline:
+//   C <input> <output>    compress in block mode
+//   D <input> <output>    decompress a block mode file
+//   STATS                 request count and latency percentiles
+// The reply is "OK <output bytes> <microseconds>", "ERR <reason>"
+// or the STATS line.
+
+// Connections waiting for a worker
+#define QUEUE_SIZE 256
+// Most workers the service starts, each keeps its own coder buffers
+#define MAX_WORKERS 64
+// Latencies kept for the percentiles (most recent requests)
+#define LATENCY_SAMPLES 4096
+#define MAX_REQUEST 8192
+// Seconds a client gets to send its request and take the reply
+#define REQUEST_TIMEOUT 10
+
+struct Server
+{
+    int fds[QUEUE_SIZE];
+    int head;
+    int count;
+    pthread_mutex_t lock;
+    pthread_cond_t ready;
+    pthread_cond_t space;
+    unsigned latency[LATENCY_SAMPLES];
+    size_t requests;
+};
+
+// A worker keeps its coder tables and output buffers between requests
+struct Worker
+{
+    struct Server *server;
+    pthread_t thread;
+    struct BlockEncoder enc;
+    struct BitWriter bw;
+    struct BlockDecoder dec;
+    unsigned char *out;
+    size_t outCap;
+};
+
+long long elapsedMicros(struct timespec *start)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - start->tv_sec) * 1000000LL + (now.tv_nsec - start->tv_nsec) / 1000;
+}
+
+void recordLatency(struct Server *server, long long micros)
+{
+    pthread_mutex_lock(&server->lock);
+    server->latency[server->requests % LATENCY_SAMPLES] = (unsigned)micros;
+    server->requests++;
+    pthread_mutex_unlock(&server->lock);
+}
+
+int compareUnsigned(const void *a, const void *b)
+{
+    unsigned x = *(const unsigned *)a, y = *(const unsigned *)b;
+
+    return (x > y) - (x < y);
+}
+
+void latencyReport(struct Server *server, char *reply, size_t size)
+{
+    unsigned sorted[LATENCY_SAMPLES];
+
+    pthread_mutex_lock(&server->lock);
+    size_t total = server->requests;
+    size_t n = total < LATENCY_SAMPLES ? total : LATENCY_SAMPLES;
+    memcpy(sorted, server->latency, n * sizeof(unsigned));
+    pthread_mutex_unlock(&server->lock);
+
+    if (n == 0)
+    {
+        snprintf(reply, size, "requests 0\n");
+        return;
+    }
+
+    qsort(sorted, n, sizeof(unsigned), compareUnsigned);
+    snprintf(reply, size, "requests %zu p50 %u us p90 %u us p99 %u us max %u us\n", total,
+             sorted[n * 50 / 100], sorted[n * 90 / 100], sorted[n * 99 / 100], sorted[n - 1]);
+}
+
+// Compress with the worker's warm context
+void serveCompress(struct Worker *worker, const char *inName, const char *outName, char *reply, size_t size)
+{
+    size_t len;
+    unsigned char *text = readWholeFile(inName, &len);
+
+    if (text == NULL)
+    {
+        snprintf(reply, size, "ERR can't read %s\n", inName);
+        return;
+    }
+
+    size_t *ends;
+    size_t count = fixedBlockEnds(len, BLOCK_SIZE, &ends);
+
+    resetBlockEncoder(&worker->enc);
+    resetBitWriter(&worker->bw);
+    encodeBlockStream(&worker->enc, text, ends, count, BLOCK_SIZE, &worker->bw);
+    free(ends);
+    free(text);
+
+    if (writeWholeFile(outName, worker->bw.buf, worker->bw.bytes) != 0)
+        snprintf(reply, size, "ERR can't write %s\n", outName);
+    else
+        snprintf(reply, size, "OK %zu", worker->bw.bytes);
+}
+
+// Decompress with the worker's decoder tables and output buffer
+void serveDecompress(struct Worker *worker, const char *inName, const char *outName, char *reply, size_t size)
+{
+    size_t len;
+    unsigned char *buf = readWholeFile(inName, &len);
+
+    if (buf == NULL)
+    {
+        snprintf(reply, size, "ERR can't read %s\n", inName);
+        return;
+    }
+
+    size_t total = 0;
+    int duplicates;
+    char error[128];
+
+    if (len < 3 || buf[0] != HUFF_MAGIC_HI || buf[1] != HUFF_MAGIC_LO || buf[2] != 'B')
+        snprintf(reply, size, "ERR %s is not a block mode file\n", inName);
+    else
+    {
+        resetBlockDecoder(&worker->dec);
+        if (decodeBlockStream(&worker->dec, buf, len, &worker->out, &worker->outCap, &total, &duplicates,
+                              error, sizeof(error)) != 0)
+            snprintf(reply, size, "ERR %s in %s\n", error, inName);
+        else if (writeWholeFile(outName, worker->out, total) != 0)
+            snprintf(reply, size, "ERR can't write %s\n", outName);
+        else
+            snprintf(reply, size, "OK %zu", total);
+    }
+
+    free(buf);
+}
+
+// Send the whole reply, 0 if the client went away
+int sendReply(int fd, const char *reply)
+{
+    size_t left = strlen(reply);
+
+    while (left > 0)
+    {
+        ssize_t n = write(fd, reply, left);
+
+        if (n <= 0)
+            return 0;
+        reply += n;
+        left -= n;
+    }
+    return 1;
+}
+
+void serveRequest(struct Worker *worker, int fd)
+{
+    char request[MAX_REQUEST];
+    char reply[256];
+    size_t got = 0;
+    struct timespec start;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    while (got < sizeof(request) - 1)
+    {
+        ssize_t n = read(fd, request + got, sizeof(request) - 1 - got);
+
+        if (n <= 0)
+            break;
+        got += n;
+        if (memchr(request + got - n, '\n', n) != NULL)
+            break;
+    }
+    request[got] = '\0';
+
+    char *save;
+    char *verb = strtok_r(request, "\t\n", &save);
+    char *inName = strtok_r(NULL, "\t\n", &save);
+    char *outName = strtok_r(NULL, "\t\n", &save);
+
+    if (verb != NULL && strcmp(verb, "STATS") == 0)
+    {
+        latencyReport(worker->server, reply, sizeof(reply));
+        sendReply(fd, reply);
+        return;
+    }
+
+    if (verb == NULL || inName == NULL || outName == NULL)
+        snprintf(reply, sizeof(reply), "ERR bad request\n");
+    else if (strcmp(verb, "C") == 0)
+        serveCompress(worker, inName, outName, reply, sizeof(reply));
+    else if (strcmp(verb, "D") == 0)
+        serveDecompress(worker, inName, outName, reply, sizeof(reply));
+    else
+        snprintf(reply, sizeof(reply), "ERR unknown request %s\n", verb);
+
+    if (strncmp(reply, "OK", 2) == 0)
+    {
+        long long micros = elapsedMicros(&start);
+
+        recordLatency(worker->server, micros);
+        snprintf(reply + strlen(reply), sizeof(reply) - strlen(reply), " %lld\n", micros);
+    }
+    if (!sendReply(fd, reply))
+        printf("Client went away before the reply: %s", reply);
+}
+
+void *workerLoop(void *arg)
+{
+    struct Worker *worker = (struct Worker *)arg;
+    struct Server *server = worker->server;
+
+    for (;;)
+    {
+        pthread_mutex_lock(&server->lock);
+        while (server->count == 0)
+            pthread_cond_wait(&server->ready, &server->lock);
+
+        int fd = server->fds[server->head];
+        server->head = (server->head + 1) % QUEUE_SIZE;
+        server->count--;
+        pthread_cond_signal(&server->space);
+        pthread_mutex_unlock(&server->lock);
+
+        serveRequest(worker, fd);
+        close(fd);
+    }
+    return NULL;
+}
+
+int runServer(const char *socketPath, int workers)
+{
+    struct sockaddr_un addr;
+    struct stat old;
+
+    // A stale socket from an earlier run is replaced, anything else is kept
+    if (lstat(socketPath, &old) == 0 && !S_ISSOCK(old.st_mode))
+    {
+        printf("%s exists and is not a socket\n", socketPath);
+        return 1;
+    }
+
+    // A client that hangs up early must not take the service down
+    signal(SIGPIPE, SIG_IGN);
+    int listenFd = socket(AF_UNIX, SOCK_STREAM, 0);
+
+    if (listenFd < 0 || strlen(socketPath) >= sizeof(addr.sun_path))
+    {
+        printf("Can't create socket %s\n", socketPath);
+        return 1;
+    }
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, socketPath);
+    unlink(socketPath);
+
+    if (bind(listenFd, (struct sockaddr *)&addr, sizeof(addr)) != 0 || listen(listenFd, QUEUE_SIZE) != 0)
+    {
+        printf("Can't listen on %s\n", socketPath);
+        close(listenFd);
+        return 1;
+    }
+
+    if (workers > MAX_WORKERS)
+        workers = MAX_WORKERS;
+
+    struct Server *server = (struct Server *)calloc(1, sizeof(struct Server));
+    struct Worker *pool = (struct Worker *)malloc(workers * sizeof(struct Worker));
+
+    pthread_mutex_init(&server->lock, NULL);
+    pthread_cond_init(&server->ready, NULL);
+    pthread_cond_init(&server->space, NULL);
+
+    // Run with as many workers as could be started
+    int started = 0;
+
+    for (int i = 0; i < workers; i++)
+    {
+        struct Worker *worker = &pool[started];
+
+        worker->server = server;
+        initBlockEncoder(&worker->enc);
+        initBitWriter(&worker->bw, BLOCK_SIZE * 4);
+        initBlockDecoder(&worker->dec);
+        worker->out = NULL;
+        worker->outCap = 0;
+
+        if (pthread_create(&worker->thread, NULL, workerLoop, worker) != 0)
+        {
+            printf("Can't start worker %d\n", i + 1);
+            freeBlockEncoder(&worker->enc);
+            free(worker->bw.buf);
+            break;
+        }
+        started++;
+    }
+
+    if (started == 0)
+    {
+        close(listenFd);
+        unlink(socketPath);
+        return 1;
+    }
+
+    printf("Listening on %s with %d workers\n", socketPath, started);
+
+    for (;;)
+    {
+        int fd = accept(listenFd, NULL, NULL);
+        struct timeval timeout = {REQUEST_TIMEOUT, 0};
+
+        if (fd < 0)
+            continue;
+
+        // A client that never finishes its request can't hold a worker
+        setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+        setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+
+        pthread_mutex_lock(&server->lock);
+        while (server->count == QUEUE_SIZE)
+            pthread_cond_wait(&server->space, &server->lock);
+        server->fds[(server->head + server->count) % QUEUE_SIZE] = fd;
+        server->count++;
+        pthread_cond_signal(&server->ready);
+        pthread_mutex_unlock(&server->lock);
+    }
+}
+#endif
+
+// Parallel encoder for the GGEazy.bin layout of main(): one table for the
+// whole input and one contiguous bitstream, split over threads in slices
+
+// Most slices (and threads) the parallel encoder uses
+#define MAX_THREADS 64
+
+struct SliceJob
+{
+    const unsigned char *data;
+    size_t len;
+    unsigned hist[256];
+    struct CodeTable *table;
+    struct BitWriter bw;
+    unsigned long long bits;
+    unsigned long long offset;
+    unsigned char *out;
+    unsigned char firstByte;
+    unsigned char lastByte;
+};
+
+void *sliceHistogram(void *arg)
+{
+    struct SliceJob *job = (struct SliceJob *)arg;
+
+    memset(job->hist, 0, sizeof(job->hist));
+    for (size_t i = 0; i < job->len; i++)
+        job->hist[job->data[i]]++;
+
+    return NULL;
+}
+
+void *sliceEncode(void *arg)
+{
+    struct SliceJob *job = (struct SliceJob *)arg;
+    struct CodeTable *table = job->table;
+
+    initBitWriter(&job->bw, job->len / 2 + 64);
+    for (size_t i = 0; i < job->len; i++)
+        putCode(&job->bw, table->code[job->data[i]], table->len[job->data[i]]);
+
+    job->bits = job->bw.bytes * 8ULL + job->bw.nbits;
+    flushBits(&job->bw);
+
+    return NULL;
+}
+
+// Copy the slice to its bit offset. The first and last byte may be
+// shared with the neighbouring slices, they are merged afterwards
+void *sliceStitch(void *arg)
+{
+    struct SliceJob *job = (struct SliceJob *)arg;
+    const unsigned char *src = job->bw.buf;
+    int shift = job->offset & 7;
+    size_t srcBytes = (job->bits + 7) / 8;
+    size_t span = (shift + job->bits + 7) / 8;
+    unsigned char *dest = job->out + job->offset / 8;
+
+    for (size_t k = 0; k < span; k++)
+    {
+        unsigned value = k < srcBytes ? src[k] >> shift : 0;
+
+        if (k > 0 && shift)
+            value |= src[k - 1] << (8 - shift);
+
+        if (k == 0)
+            job->firstByte = (unsigned char)value;
+        else if (k == span - 1)
+            job->lastByte = (unsigned char)value;
+        else
+            dest[k] = (unsigned char)value;
+    }
+
+    return NULL;
+}
+
+void runSliceJobs(struct SliceJob *jobs, int threads, void *(*work)(void *))
+{
+#ifndef _WIN32
+    pthread_t tid[MAX_THREADS];
+    int started[MAX_THREADS];
+
+    // A slice whose thread can't be started runs here instead
+    for (int i = 0; i < threads; i++)
+    {
+        started[i] = pthread_create(&tid[i], NULL, work, &jobs[i]) == 0;
+        if (!started[i])
+            work(&jobs[i]);
+    }
+    for (int i = 0; i < threads; i++)
+    {
+        if (started[i])
+            pthread_join(tid[i], NULL);
+    }
+#else
+    for (int i = 0; i < threads; i++)
+        work(&jobs[i]);
+#endif
+}
+
+// Same header as passSize, password and Freq (size, symbols and
+// frequencies, 8 bits each) followed by the codes. Like
+// binaryStringToFile, a last partial byte keeps its bits at the bottom
+int compressParallel(const char *inName, const char *outName, int threads)
+{
+    size_t len;
+    unsigned char *text = readWholeFile(inName, &len);
+
+    if (text == NULL)
+        return 1;
+
+    // No more slices than bytes
+    if (threads > MAX_THREADS)
+        threads = MAX_THREADS;
+    if ((size_t)threads > (len > 0 ? len : 1))
+        threads = (int)(len > 0 ? len : 1);
+
+    struct SliceJob *jobs = (struct SliceJob *)calloc(threads, sizeof(struct SliceJob));
+    size_t slice = len / threads + 1;
+
+    for (int i = 0; i < threads; i++)
+    {
+        size_t start = slice * i < len ? slice * i : len;
+
+        jobs[i].data = text + start;
+        jobs[i].len = len - start < slice ? len - start : slice;
+    }
+
+    runSliceJobs(jobs, threads, sliceHistogram);
+
+    int item[256], freq[256], size = 0;
+
+    for (int c = 0; c < 256; c++)
+    {
+        unsigned total = 0;
+
+        for (int i = 0; i < threads; i++)
+            total += jobs[i].hist[c];
+
+        if (total != 0)
+        {
+            item[size] = c;
+            freq[size] = total;
+            size++;
+        }
+    }
+
+    size_t header = 1 + 2 * size;
+    struct CodeTable *table = newCodeTable(256);
+
+    if (size > 0)
+    {
+        struct MinHNode *root = buildHuffmanTree(item, freq, size);
+
+        buildCodeTable(root, 0, 0, table);
+        freeHuffmanTree(root);
+    }
+
+    for (int i = 0; i < threads; i++)
+        jobs[i].table = table;
+    runSliceJobs(jobs, threads, sliceEncode);
+
+    // Prefix sum of the slice lengths gives every slice its bit offset
+    unsigned long long bits = header * 8ULL;
+
+    for (int i = 0; i < threads; i++)
+    {
+        jobs[i].offset = bits;
+        bits += jobs[i].bits;
+    }
+
+    size_t outLen = (bits + 7) / 8;
+    unsigned char *out = (unsigned char *)calloc(outLen + 1, 1);
+
+    out[0] = (unsigned char)size;
+    for (int i = 0; i < size; i++)
+    {
+        out[1 + i] = (unsigned char)item[i];
+        out[1 + size + i] = (unsigned char)freq[i];
+    }
+
+    for (int i = 0; i < threads; i++)
+        jobs[i].out = out;
+    runSliceJobs(jobs, threads, sliceStitch);
+
+    for (int i = 0; i < threads; i++)
+    {
+        size_t span = ((jobs[i].offset & 7) + jobs[i].bits + 7) / 8;
+
+        if (span > 0)
+            out[jobs[i].offset / 8] |= jobs[i].firstByte;
+        if (span > 1)
+            out[jobs[i].offset / 8 + span - 1] |= jobs[i].lastByte;
+        free(jobs[i].bw.buf);
+    }
+
+    if (bits % 8)
+        out[outLen - 1] >>= 8 - bits % 8;
+
+    int result = writeWholeFile(outName, out, outLen);
+
+    printf("Threads: %d  Input: %zu bytes  Output: %zu bytes\n", threads, len, outLen);
+
+    freeCodeTable(table);
+    free(out);
+    free(jobs);
+    free(text);
+    return result;
+}
+
+// Message batch ('M'): every line of the input is a message coded on
+// its own with one table shared by all. Layout: magic, mode, the table
+// as in an 'N' record, message count, raw and payload length of every
+// message, then the byte aligned payloads
+int compressMessages(const char *inName, const char *outName)
+{
+    size_t len;
+    unsigned char *text = readWholeFile(inName, &len);
+
+    if (text == NULL)
+        return 1;
+
+    unsigned hist[256] = {0};
+    int item[256], freq[256], size = 0;
+
+    for (size_t i = 0; i < len; i++)
+        hist[text[i]]++;
+
+    for (int i = 0; i < 256; i++)
+    {
+        if (hist[i] != 0)
+        {
+            item[size] = i;
+            freq[size] = hist[i];
+            size++;
+        }
+    }
+
+    // An empty input still gets a one symbol table
+    if (size == 0)
+    {
+        item[0] = 0;
+        freq[0] = 0;
+        size = 1;
+    }
+
+    struct CodeTable *table = newCodeTable(256);
+    struct MinHNode *root = buildHuffmanTree(item, freq, size);
+
+    buildCodeTable(root, 0, 0, table);
+    freeHuffmanTree(root);
+
+    // Each message ends after a newline
+    size_t count = 0;
+    size_t *ends = (size_t *)malloc((len + 1) * sizeof(size_t));
+
+    for (size_t i = 0; i < len; i++)
+    {
+        if (text[i] == '\n' || i == len - 1)
+            ends[count++] = i + 1;
+    }
+
+    struct BitWriter payload;
+    struct BitWriter bw;
+
+    initBitWriter(&payload, len / 2 + 64);
+    initBitWriter(&bw, count * 8 + size * 5 + 64);
+
+    putBits(&bw, HUFF_MAGIC_HI, 8);
+    putBits(&bw, HUFF_MAGIC_LO, 8);
+    putBits(&bw, 'M', 8);
+    putBits(&bw, size - 1, 8);
+    for (int i = 0; i < size; i++)
+    {
+        putBits(&bw, item[i], 8);
+        putU32(&bw, freq[i]);
+    }
+    putU32(&bw, (unsigned)count);
+
+    for (size_t m = 0, start = 0; m < count; start = ends[m++])
+    {
+        size_t before = payload.bytes;
+
+        for (size_t i = start; i < ends[m]; i++)
+            putCode(&payload, table->code[text[i]], table->len[text[i]]);
+        flushBits(&payload);
+
+        putU32(&bw, (unsigned)(ends[m] - start));
+        putU32(&bw, (unsigned)(payload.bytes - before));
+    }
+
+    memcpy(reserveBytes(&bw, payload.bytes), payload.buf, payload.bytes);
+    bw.bytes += payload.bytes;
+
+    int result = writeWholeFile(outName, bw.buf, bw.bytes);
+
+    printf("Messages: %zu  Input: %zu bytes  Output: %zu bytes\n", count, len, bw.bytes);
+
+    freeCodeTable(table);
+    free(payload.buf);
+    free(bw.buf);
+    free(ends);
+    free(text);
+    return result;
+}
+
+int main(int argc, char *argv[])
+{
+    // Word or 16-bit symbol alphabet: -w|-s input output
+    if (argc == 4 && (strcmp(argv[1], "-w") == 0 || strcmp(argv[1], "-s") == 0))
+        return compressWide(argv[2], argv[3], argv[1][1] == 'w');
+
+    // Block mode with a cache of recent tables: -b input output [block size]
+    if ((argc == 4 || argc == 5) && strcmp(argv[1], "-b") == 0)
+    {
+        // The block size shares its header field with ADAPTIVE_BLOCKS
+        long long blockSize = argc == 5 ? atoll(argv[4]) : 0;
+
+        if (blockSize >= (long long)ADAPTIVE_BLOCKS)
+        {
+            printf("Block size must be below %u bytes\n", ADAPTIVE_BLOCKS);
+            return 1;
+        }
+        return compressBlocks(argv[2], argv[3], blockSize > 0 ? (size_t)blockSize : BLOCK_SIZE);
+    }
+
+    // Block mode cut where the statistics change: -a input output
+    if (argc == 4 && strcmp(argv[1], "-a") == 0)
+        return compressBlocks(argv[2], argv[3], 0);
+
+    // Append to the output of an earlier -b or -a run: -i input output
+    if (argc == 4 && strcmp(argv[1], "-i") == 0)
+        return compressAppend(argv[2], argv[3]);
+
+    // One message per line with a shared table: -m input output
+    if (argc == 4 && strcmp(argv[1], "-m") == 0)
+        return compressMessages(argv[2], argv[3]);
+
+    // GGEazy.bin layout for the whole input on several threads:
+    // -p input output [threads]
+    if ((argc == 4 || argc == 5) && strcmp(argv[1], "-p") == 0)
+        return compressParallel(argv[2], argv[3], argc == 5 && atoi(argv[4]) > 0 ? atoi(argv[4]) : 4);
+
+#ifndef _WIN32
+    // Resident service: -D socket [workers]
+    if ((argc == 3 || argc == 4) && strcmp(argv[1], "-D") == 0)
+        return runServer(argv[2], argc == 4 && atoi(argv[3]) > 0 ? atoi(argv[3]) : 4);
+#endif
+
+
     FILE *filepointer;
     char filename[]="GGWABC.txt";
 
 
     int ch, j = 0, capacity = 10, size = 0;
     int character[128] = {};
-    char *arr = NULL; // items
+    int *arr = NULL; // items
     int *freq = NULL;
 
     char put[10000] = {}; // Adjust the size based on your needs , texts
@@ -448,7 +2528,7 @@ int main()
 
     fclose(filepointer);
 
-    arr = (char *)malloc(capacity * sizeof(char));
+    arr = (int *)malloc(capacity * sizeof(int));
     freq = (int *)malloc(capacity * sizeof(int));
 
     for (int i = 0; i < 128; i++)
@@ -458,7 +2538,7 @@ int main()
             if (size == capacity)
             {
                 capacity *= 2;
-                arr = (char *)realloc(arr, capacity * sizeof(char));
+                arr = (int *)realloc(arr, capacity * sizeof(int));
                 freq = (int *)realloc(freq, capacity * sizeof(int));
             }
             arr[j] = i;
@@ -2,12 +2,13 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 
 #define MAX_TREE_HT 100
 
 struct MinHNode
 {
-    char item;
+    int item;
     unsigned freq;
     struct MinHNode *left, *right;
 };
@@ -20,7 +21,7 @@ struct MinHeap
 };
 
 // Create nodes
-struct MinHNode *newNode(char item, unsigned freq)
+struct MinHNode *newNode(int item, unsigned freq)
 {
     struct MinHNode *temp = (struct MinHNode *)malloc(sizeof(struct MinHNode));
 
@@ -118,7 +119,7 @@ int isLeaf(struct MinHNode *root)
     return !(root->left) && !(root->right);
 }
 
-struct MinHeap *createAndBuildMinHeap(char item[], int freq[], int size)
+struct MinHeap *createAndBuildMinHeap(int item[], int freq[], int size)
 {
     struct MinHeap *minHeap = createMinH(size);
 
@@ -131,7 +132,7 @@ struct MinHeap *createAndBuildMinHeap(char item[], int freq[], int size)
     return minHeap;
 }
 
-struct MinHNode *buildHuffmanTree(char item[], int freq[], int size)
+struct MinHNode *buildHuffmanTree(int item[], int freq[], int size)
 {
     struct MinHNode *left, *right, *top;
     struct MinHeap *minHeap = createAndBuildMinHeap(item, freq, size);
@@ -148,7 +149,12 @@ struct MinHNode *buildHuffmanTree(char item[], int freq[], int size)
 
         insertMinHeap(minHeap, top);
     }
-    return extractMin(minHeap);
+
+    struct MinHNode *root = extractMin(minHeap);
+
+    free(minHeap->array);
+    free(minHeap);
+    return root;
 }
 
 void printArray(int arr[], int n);
@@ -175,7 +181,7 @@ void printHCodes(struct MinHNode *root, int arr[], int top,int freq[],char text[
 }
 void writeHuffmanCodes(struct MinHNode *root, int arr[], int top, int freq[], char text[]);
 // Wrapper function
-void HuffmanCodes(struct MinHNode *root,char item[],int freq[], int size,char text[])
+void HuffmanCodes(struct MinHNode *root,int item[],int freq[], int size,char text[])
 {
     struct MinHNode *root1 = buildHuffmanTree(item, freq, size);
 
@@ -326,8 +332,422 @@ void intToBinary(char ch, char *binary,char *put)
     strcat(put,binary);
     printf("Binary representation of %c: %s\n",ch, binary);
 }
-int main()
+// Read a whole file into memory, the length is returned in *len
+unsigned char *readWholeFile(const char *filename, size_t *len)
+{
+    FILE *file = fopen(filename, "rb");
+
+    if (file == NULL)
+    {
+        printf("Can't read file %s\n", filename);
+        return NULL;
+    }
+
+    // The size is only a first guess, pipes have none, so read to EOF
+    long size = fseek(file, 0, SEEK_END) == 0 ? ftell(file) : -1;
+    size_t cap = size > 0 ? (size_t)size + 1 : 65536;
+    unsigned char *buf = (unsigned char *)malloc(cap);
+
+    if (size >= 0)
+        rewind(file);
+    *len = 0;
+
+    while (buf != NULL)
+    {
+        *len += fread(buf + *len, 1, cap - *len, file);
+        if (*len < cap)
+            break;
+
+        unsigned char *grown = (unsigned char *)realloc(buf, cap * 2);
+
+        if (grown == NULL)
+        {
+            free(buf);
+            buf = NULL;
+        }
+        else
+        {
+            buf = grown;
+            cap *= 2;
+        }
+    }
+
+    if (buf == NULL || ferror(file))
+    {
+        printf("Can't read file %s\n", filename);
+        free(buf);
+        buf = NULL;
+    }
+
+    fclose(file);
+    return buf;
+}
+
+int writeWholeFile(const char *filename, const unsigned char *buf, size_t len)
+{
+    FILE *file = fopen(filename, "wb");
+
+    if (file == NULL)
+    {
+        printf("Error opening file %s\n", filename);
+        return 1;
+    }
+
+    fwrite(buf, 1, len, file);
+    fclose(file);
+    return 0;
+}
+
+// Free a tree returned by buildHuffmanTree
+void freeHuffmanTree(struct MinHNode *root)
 {
+    if (root == NULL)
+        return;
+
+    freeHuffmanTree(root->left);
+    freeHuffmanTree(root->right);
+    free(root);
+}
+
+#include "Huffman_code_Block.h"
+
+// Word ('W') and 16-bit symbol ('S') files, every
+// symbol copies its whole token to the output
+int decompressWide(const unsigned char *buf, size_t len, const char *outName)
+{
+    // Every dictionary entry takes at least 5 bytes
+    if (len < 7 || getU32(buf + 3) > (len - 7) / 5)
+    {
+        printf("Dictionary is cut short\n");
+        return 9;
+    }
+
+    size_t pos = 7;
+    int count = (int)getU32(buf + 3);
+
+    const unsigned char **token = (const unsigned char **)malloc((count + 1) * sizeof(unsigned char *));
+    int *length = (int *)malloc((count + 1) * sizeof(int));
+    int *freq = (int *)malloc((count + 1) * sizeof(int));
+    int *items = (int *)malloc((count + 1) * sizeof(int));
+    size_t outLen = 0;
+    int result = 0;
+
+    for (int i = 0; i < count; i++)
+    {
+        if (pos >= len || pos + 1 + buf[pos] + 4 > len)
+        {
+            result = 9;
+            break;
+        }
+        length[i] = buf[pos];
+        token[i] = buf + pos + 1;
+        pos += 1 + length[i];
+        freq[i] = (int)getU32(buf + pos);
+        pos += 4;
+        items[i] = i;
+        outLen += (size_t)freq[i] * length[i];
+    }
+
+    if (result != 0 || pos + 4 > len)
+    {
+        printf("Dictionary is cut short\n");
+        result = 9;
+    }
+
+    size_t tokens = result == 0 ? getU32(buf + pos) : 0;
+    unsigned char *out = result == 0 ? (unsigned char *)malloc(outLen + 1) : NULL;
+    size_t o = 0;
+
+    pos += 4;
+    if (result == 0 && out == NULL)
+    {
+        printf("Not enough memory for %zu bytes\n", outLen);
+        result = 9;
+    }
+
+    if (result == 0 && count > 0)
+    {
+        struct MinHNode *root = buildHuffmanTree(items, freq, count);
+        struct DecodeTable *dt = newDecodeTable(root);
+        struct BitReader br;
+
+        initBitReader(&br, buf + pos, len - pos);
+
+        for (size_t i = 0; i < tokens && result == 0; i++)
+        {
+            int sym = decodeSymbol(dt, &br);
+
+            if (sym < 0 || o + length[sym] > outLen)
+            {
+                printf("Corrupt data at token %zu\n", i);
+                result = 9;
+            }
+            else
+            {
+                memcpy(out + o, token[sym], length[sym]);
+                o += length[sym];
+            }
+        }
+        free(dt);
+        freeHuffmanTree(root);
+    }
+
+    if (result == 0)
+    {
+        printf("Tokens: %zu  Output: %zu bytes\n", tokens, o);
+        result = writeWholeFile(outName, out, o);
+    }
+
+    free(out);
+    free(items);
+    free(freq);
+    free(length);
+    free(token);
+    return result;
+}
+
+// Block mode ('B') files
+int decompressBlocks(const unsigned char *buf, size_t len, const char *outName)
+{
+    struct BlockDecoder dec;
+    unsigned char *out = NULL;
+    size_t outCap = 0, total = 0;
+    int duplicates = 0;
+    char error[128];
+
+    initBlockDecoder(&dec);
+
+    int result = decodeBlockStream(&dec, buf, len, &out, &outCap, &total, &duplicates, error, sizeof(error));
+
+    if (result != 0)
+        printf("%s\n", error);
+    else
+    {
+        printf("Blocks: %zu, %d duplicate  Output: %zu bytes\n", (size_t)getU32(buf + len - 4), duplicates, total);
+        result = writeWholeFile(outName, out, total);
+    }
+
+    freeBlockDecoder(&dec);
+    free(out);
+    return result;
+}
+
+// Messages decoded side by side in decodeBatch
+#define BATCH_LANES 4
+
+// Decode count messages that share one decode table. Message m is
+// msgs[m] (msgLens[m] bytes) and decodes to rawLens[m] bytes, written
+// back to back into the caller's arena; outOffsets[m] gets its start.
+// BATCH_LANES messages advance together so their table lookups don't
+// wait on each other. Returns 0, or -1 on a bad message or a full arena
+int decodeBatch(struct DecodeTable *dt, const unsigned char **msgs, const size_t *msgLens, const size_t *rawLens,
+                size_t count, unsigned char *arena, size_t arenaCap, size_t *outOffsets)
+{
+    size_t o = 0;
+
+    for (size_t m = 0; m < count; m += BATCH_LANES)
+    {
+        int lanes = count - m < BATCH_LANES ? (int)(count - m) : BATCH_LANES;
+        struct BitReader br[BATCH_LANES];
+        unsigned char *out[BATCH_LANES];
+        size_t common = (size_t)-1;
+
+        for (int l = 0; l < lanes; l++)
+        {
+            if (o + rawLens[m + l] > arenaCap)
+                return -1;
+
+            initBitReader(&br[l], msgs[m + l], msgLens[m + l]);
+            out[l] = arena + o;
+            outOffsets[m + l] = o;
+            o += rawLens[m + l];
+            if (rawLens[m + l] < common)
+                common = rawLens[m + l];
+        }
+
+        for (size_t i = 0; i < common; i++)
+        {
+            for (int l = 0; l < lanes; l++)
+            {
+                int sym = decodeSymbol(dt, &br[l]);
+
+                if (sym < 0)
+                    return -1;
+                out[l][i] = (unsigned char)sym;
+            }
+        }
+
+        // Finish the longer messages of the group one at a time
+        for (int l = 0; l < lanes; l++)
+        {
+            for (size_t i = common; i < rawLens[m + l]; i++)
+            {
+                int sym = decodeSymbol(dt, &br[l]);
+
+                if (sym < 0)
+                    return -1;
+                out[l][i] = (unsigned char)sym;
+            }
+        }
+    }
+
+    return 0;
+}
+
+// Message batch ('M') files, all messages go through one decodeBatch call
+int decompressMessages(const unsigned char *buf, size_t len, const char *outName)
+{
+    if (len < 4)
+    {
+        printf("Header is cut short\n");
+        return 9;
+    }
+
+    int size = buf[3] + 1;
+    size_t pos = 4 + size * 5;
+
+    if (pos + 4 > len)
+    {
+        printf("Header is cut short\n");
+        return 9;
+    }
+
+    int item[256], freq[256];
+
+    for (int i = 0; i < size; i++)
+    {
+        item[i] = buf[4 + i * 5];
+        freq[i] = (int)getU32(buf + 5 + i * 5);
+    }
+
+    size_t count = getU32(buf + pos);
+    pos += 4;
+
+    if (count > (len - pos) / 8)
+    {
+        printf("Message list is cut short\n");
+        return 9;
+    }
+
+    const unsigned char **msgs = (const unsigned char **)malloc((count + 1) * sizeof(unsigned char *));
+    size_t *msgLens = (size_t *)malloc((count + 1) * sizeof(size_t));
+    size_t *rawLens = (size_t *)malloc((count + 1) * sizeof(size_t));
+    size_t *outOffsets = (size_t *)malloc((count + 1) * sizeof(size_t));
+    size_t payload = pos + count * 8;
+    size_t total = 0;
+    int result = 0;
+
+    // Every code is at least one bit long, so a message can't decode
+    // to more than 8 bytes per payload byte. That also bounds the arena
+    for (size_t m = 0; m < count && result == 0; m++)
+    {
+        rawLens[m] = getU32(buf + pos + m * 8);
+        msgLens[m] = getU32(buf + pos + m * 8 + 4);
+        msgs[m] = buf + payload;
+        total += rawLens[m];
+        payload += msgLens[m];
+
+        if (rawLens[m] > msgLens[m] * 8)
+        {
+            printf("Message %zu is damaged\n", m);
+            result = 9;
+        }
+    }
+
+    if (result == 0 && payload > len)
+    {
+        printf("Messages are cut short\n");
+        result = 9;
+    }
+
+    unsigned char *arena = result == 0 ? (unsigned char *)malloc(total + 1) : NULL;
+
+    if (result == 0 && arena == NULL)
+    {
+        printf("Not enough memory for %zu bytes\n", total);
+        result = 9;
+    }
+
+    if (result == 0 && count > 0)
+    {
+        struct MinHNode *root = buildHuffmanTree(item, freq, size);
+        struct DecodeTable *dt = newDecodeTable(root);
+        clock_t start = clock();
+
+        if (decodeBatch(dt, msgs, msgLens, rawLens, count, arena, total, outOffsets) != 0)
+        {
+            printf("Corrupt message in batch\n");
+            result = 9;
+        }
+
+        double seconds = (double)(clock() - start) / CLOCKS_PER_SEC;
+
+        if (seconds > 0)
+            printf("Batch: %zu messages in %.3f ms, %.0f messages/s\n", count, seconds * 1000, count / seconds);
+        else
+            printf("Batch: %zu messages in under a clock tick\n", count);
+
+        freeHuffmanTree(root);
+        free(dt);
+    }
+
+    if (result == 0)
+        result = writeWholeFile(outName, arena, total);
+
+    free(arena);
+    free(outOffsets);
+    free(rawLens);
+    free(msgLens);
+    free(msgs);
+    return result;
+}
+
+// Pick the decoder from the mode byte after the magic
+int decompressFile(const char *inName, const char *outName)
+{
+    size_t len;
+    unsigned char *buf = readWholeFile(inName, &len);
+
+    if (buf == NULL)
+        return 1;
+
+    if (len < 3 || buf[0] != 0x95 || buf[1] != 0xF0)
+    {
+        printf("This data doesn't encode by G1ilbert\n");
+        free(buf);
+        return 9;
+    }
+
+    int result;
+
+    switch (buf[2])
+    {
+    case 'W':
+    case 'S':
+        result = decompressWide(buf, len, outName);
+        break;
+    case 'B':
+        result = decompressBlocks(buf, len, outName);
+        break;
+    case 'M':
+        result = decompressMessages(buf, len, outName);
+        break;
+    default:
+        printf("Unknown mode %c\n", buf[2]);
+        result = 9;
+    }
+
+    free(buf);
+    return result;
+}
+
+int main(int argc, char *argv[])
+{
+    // Files from the new compressor modes: input output
+    if (argc == 3)
+        return decompressFile(argv[1], argv[2]);
+
+
     FILE *filepointer;
     char filename[]="GGWABC.txt";
 